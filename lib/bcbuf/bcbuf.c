@@ -0,0 +1,256 @@
+#include "bcbuf.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+
+/*
+ * one writer thread, each reader owned by one thread.
+ * sequences only grow, slot of sequence s is s & (ecount - 1).
+ * the writer publishes wseq after the slot is written (release),
+ * readers publish rseq after the slot is consumed (release).
+ */
+
+static inline void *bcbuf_slot(struct bcbuf *ptrbcbuf, unsigned long seq)
+{
+    return (char *)ptrbcbuf->buf + (seq & (bcbuf_size(ptrbcbuf) - 1)) * bcbuf_element_size(ptrbcbuf);
+}
+
+static inline unsigned long bcbuf_load_wseq(struct bcbuf *ptrbcbuf)
+{
+    return __atomic_load_n(&ptrbcbuf->wseq, __ATOMIC_ACQUIRE);
+}
+
+/* the slowest active reader, wseq if there is none */
+static unsigned long bcbuf_min_rseq(struct bcbuf *ptrbcbuf)
+{
+    unsigned long min = ptrbcbuf->wseq;
+    for (unsigned int i = 0; i < ptrbcbuf->nreaders; i++)
+    {
+        struct bcbuf_reader *reader = &ptrbcbuf->readers[i];
+        if (!__atomic_load_n(&reader->active, __ATOMIC_ACQUIRE))
+        {
+            continue;
+        }
+        unsigned long rseq = __atomic_load_n(&reader->rseq, __ATOMIC_ACQUIRE);
+        /* compare distances to wseq, sequences may wrap */
+        if (ptrbcbuf->wseq - rseq > ptrbcbuf->wseq - min)
+        {
+            min = rseq;
+        }
+    }
+    return min;
+}
+
+/* number of slots the writer may fill in one write, up to want */
+static unsigned int bcbuf_writable(struct bcbuf *ptrbcbuf, unsigned int want)
+{
+    /*
+     * never wait, but a write must not reach a slot of a reader
+     * that is not yet behind by more than maxlag, or the lap goes unseen.
+     */
+    if (ptrbcbuf->maxlag)
+    {
+        return bcbuf_size(ptrbcbuf) - ptrbcbuf->maxlag;
+    }
+
+    /* only rescan readers when the cached gate is not enough */
+    if (bcbuf_size(ptrbcbuf) - (ptrbcbuf->wseq - ptrbcbuf->gate) < want)
+    {
+        ptrbcbuf->gate = bcbuf_min_rseq(ptrbcbuf);
+    }
+    return bcbuf_size(ptrbcbuf) - (ptrbcbuf->wseq - ptrbcbuf->gate);
+}
+
+int bcbuf_alloc(struct bcbuf *ptrbcbuf, unsigned int ecount, size_t esize, unsigned int nreaders, unsigned int maxlag)
+{
+    /* ecount must be power of 2, and maxlag keeps a lapped reader off the slot being written */
+    if (ecount == 0 || (ecount & (ecount - 1)) || esize == 0 || nreaders == 0 || maxlag >= ecount)
+    {
+        return -1;
+    }
+    /* byte sizes must not wrap, esize must fit its field */
+    if (ecount > SIZE_MAX / esize)
+    {
+        return -1;
+    }
+#if SIZE_MAX > UINT_MAX
+    if (esize > UINT_MAX)
+    {
+        return -1;
+    }
+#endif
+#if SIZE_MAX / BCBUF_CACHELINE < UINT_MAX
+    if (nreaders > SIZE_MAX / sizeof(struct bcbuf_reader))
+    {
+        return -1;
+    }
+#endif
+
+    ptrbcbuf->buf = malloc(ecount * esize);
+    if (ptrbcbuf->buf == NULL)
+    {
+        return -1;
+    }
+
+    ptrbcbuf->readers = aligned_alloc(BCBUF_CACHELINE, nreaders * sizeof(struct bcbuf_reader));
+    if (ptrbcbuf->readers == NULL)
+    {
+        free(ptrbcbuf->buf);
+        ptrbcbuf->buf = NULL;
+        return -1;
+    }
+    memset(ptrbcbuf->readers, 0, nreaders * sizeof(struct bcbuf_reader));
+
+    ptrbcbuf->wseq = 0;
+    ptrbcbuf->gate = 0;
+    ptrbcbuf->ecount = ecount;
+    ptrbcbuf->esize = esize;
+    ptrbcbuf->maxlag = maxlag;
+    ptrbcbuf->nreaders = nreaders;
+
+    return 0;
+}
+
+int bcbuf_free(struct bcbuf *ptrbcbuf)
+{
+    free(ptrbcbuf->buf);
+    free(ptrbcbuf->readers);
+    ptrbcbuf->buf = NULL;
+    ptrbcbuf->readers = NULL;
+    ptrbcbuf->wseq = 0;
+    ptrbcbuf->gate = 0;
+    ptrbcbuf->ecount = 0;
+    ptrbcbuf->esize = 0;
+    ptrbcbuf->nreaders = 0;
+    return 0;
+}
+
+/*
+ * register a reader starting from the next written element.
+ * call before the writer starts or from the writer thread.
+ * return NULL if all readers are in use.
+ */
+struct bcbuf_reader *bcbuf_reader_add(struct bcbuf *ptrbcbuf)
+{
+    for (unsigned int i = 0; i < ptrbcbuf->nreaders; i++)
+    {
+        struct bcbuf_reader *reader = &ptrbcbuf->readers[i];
+        if (reader->active)
+        {
+            continue;
+        }
+        reader->rseq = ptrbcbuf->wseq;
+        reader->lapped = 0;
+        __atomic_store_n(&reader->active, 1, __ATOMIC_RELEASE);
+        return reader;
+    }
+    return NULL;
+}
+
+int bcbuf_reader_remove(struct bcbuf *ptrbcbuf, struct bcbuf_reader *reader)
+{
+    if (reader < ptrbcbuf->readers || reader >= ptrbcbuf->readers + ptrbcbuf->nreaders)
+    {
+        return -1;
+    }
+    __atomic_store_n(&reader->active, 0, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* skip everything written so far and clear lapped */
+void bcbuf_reader_resync(struct bcbuf *ptrbcbuf, struct bcbuf_reader *reader)
+{
+    reader->lapped = 0;
+    __atomic_store_n(&reader->rseq, bcbuf_load_wseq(ptrbcbuf), __ATOMIC_RELEASE);
+}
+
+unsigned int bcbuf_put(struct bcbuf *ptrbcbuf, const void *buf)
+{
+    return bcbuf_write(ptrbcbuf, buf, 1);
+}
+
+unsigned int bcbuf_write(struct bcbuf *ptrbcbuf, const void *buf, unsigned int ecount)
+{
+    unsigned int writable = bcbuf_writable(ptrbcbuf, ecount);
+    if (writable < ecount)
+    {
+        ecount = writable;
+    }
+    if (ecount == 0)
+    {
+        return 0;
+    }
+
+    /* a lapped reader checks wseq after reading, so wseq must be seen before new data */
+    if (ptrbcbuf->maxlag)
+    {
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    size_t esize = bcbuf_element_size(ptrbcbuf);
+    unsigned int first = bcbuf_size(ptrbcbuf) - (ptrbcbuf->wseq & (bcbuf_size(ptrbcbuf) - 1));
+    if (first > ecount)
+    {
+        first = ecount;
+    }
+    memcpy(bcbuf_slot(ptrbcbuf, ptrbcbuf->wseq), buf, first * esize);
+    memcpy(ptrbcbuf->buf, (const char *)buf + first * esize, (ecount - first) * esize);
+
+    __atomic_store_n(&ptrbcbuf->wseq, ptrbcbuf->wseq + ecount, __ATOMIC_RELEASE);
+    return ecount;
+}
+
+/*
+ * point slot at the next unread element of reader, no copy is made.
+ * return the number of elements readable from slot without wrapping,
+ * 0 if there is nothing to read or the reader is lapped.
+ */
+unsigned int bcbuf_peek(struct bcbuf *ptrbcbuf, struct bcbuf_reader *reader, const void **slot)
+{
+    unsigned long wseq = bcbuf_load_wseq(ptrbcbuf);
+    unsigned long rseq = reader->rseq;
+
+    if (ptrbcbuf->maxlag && wseq - rseq > ptrbcbuf->maxlag)
+    {
+        reader->lapped = 1;
+    }
+    if (reader->lapped || wseq == rseq)
+    {
+        return 0;
+    }
+
+    unsigned int len = wseq - rseq;
+    unsigned int first = bcbuf_size(ptrbcbuf) - (rseq & (bcbuf_size(ptrbcbuf) - 1));
+    *slot = bcbuf_slot(ptrbcbuf, rseq);
+    return len < first ? len : first;
+}
+
+/*
+ * mark ecount elements from bcbuf_peek consumed, the writer may reuse them.
+ * return 0, or -1 if ecount is more than written or the reader got lapped
+ * while the slots were in use, their content can not be trusted then.
+ */
+int bcbuf_release(struct bcbuf *ptrbcbuf, struct bcbuf_reader *reader, unsigned int ecount)
+{
+    unsigned long rseq = reader->rseq;
+
+    if (ecount > bcbuf_load_wseq(ptrbcbuf) - rseq)
+    {
+        return -1;
+    }
+
+    if (ptrbcbuf->maxlag)
+    {
+        /* the slot reads above must not pass the wseq load */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (bcbuf_load_wseq(ptrbcbuf) - rseq > ptrbcbuf->maxlag)
+        {
+            reader->lapped = 1;
+            return -1;
+        }
+    }
+
+    __atomic_store_n(&reader->rseq, rseq + ecount, __ATOMIC_RELEASE);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef C_LIB_BCBUF_H_
+#define C_LIB_BCBUF_H_
+
+#include <stddef.h>
+
+#define BCBUF_CACHELINE 64
+
+struct bcbuf_reader
+{
+    unsigned long rseq;  /* next sequence to read */
+    unsigned int active; /* reader is registered */
+    unsigned int lapped; /* writer overran this reader */
+} __attribute__((aligned(BCBUF_CACHELINE)));
+
+struct bcbuf
+{
+    unsigned int ecount;          /* elements count, power of 2 */
+    unsigned int esize;           /* sizeof(Element) */
+    unsigned int maxlag;          /* 0: writer waits slowest reader, otherwise readers behind more are lapped */
+    unsigned int nreaders;        /* readers array size */
+    struct bcbuf_reader *readers; /* per reader cursors, one cache line each */
+    void *buf;                    /* elements data buffer */
+    unsigned long wseq __attribute__((aligned(BCBUF_CACHELINE))); /* next sequence to write */
+    unsigned long gate;           /* writer cached slowest reader sequence */
+};
+
+#define bcbuf_size(ptrbcbuf) ((ptrbcbuf)->ecount)
+#define bcbuf_element_size(ptrbcbuf) ((ptrbcbuf)->esize)
+#define bcbuf_is_lapped(ptrreader) ((ptrreader)->lapped)
+
+extern int bcbuf_alloc(struct bcbuf *ptrbcbuf, unsigned int ecount, size_t esize, unsigned int nreaders, unsigned int maxlag);
+extern int bcbuf_free(struct bcbuf *ptrbcbuf);
+extern struct bcbuf_reader *bcbuf_reader_add(struct bcbuf *ptrbcbuf);
+extern int bcbuf_reader_remove(struct bcbuf *ptrbcbuf, struct bcbuf_reader *reader);
+extern void bcbuf_reader_resync(struct bcbuf *ptrbcbuf, struct bcbuf_reader *reader);
+extern unsigned int bcbuf_put(struct bcbuf *ptrbcbuf, const void *buf);
+extern unsigned int bcbuf_write(struct bcbuf *ptrbcbuf, const void *buf, unsigned int ecount);
+extern unsigned int bcbuf_peek(struct bcbuf *ptrbcbuf, struct bcbuf_reader *reader, const void **slot);
+extern int bcbuf_release(struct bcbuf *ptrbcbuf, struct bcbuf_reader *reader, unsigned int ecount);
+
+#endif
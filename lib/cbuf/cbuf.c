@@ -1,6 +1,11 @@
 #include "cbuf.h"
+#include "../mempool/mempool.h"
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 static inline void *cbuf_raw(struct cbuf *ptrcbuffer)
 {
@@ -32,6 +37,52 @@ static inline unsigned int cbuf_rawlen(struct cbuf *ptrcbuffer)
     return (cbuf_len(ptrcbuffer) * cbuf_element_size(ptrcbuffer));
 }
 
+/* clear elements after they are read, build with CBUF_NO_CLEAR to skip it */
+#ifndef CBUF_NO_CLEAR
+#define cbuf_clear(p, nbytes) memset(p, 0, nbytes)
+#else
+#define cbuf_clear(p, nbytes)
+#endif
+
+#ifdef CBUF_STATS
+static inline void cbuf_stat_put(struct cbuf *ptrcbuffer, unsigned int want, unsigned int done)
+{
+    ptrcbuffer->stats.puts += done;
+    ptrcbuffer->stats.full += done < want;
+    if (cbuf_len(ptrcbuffer) > ptrcbuffer->stats.peak)
+    {
+        ptrcbuffer->stats.peak = cbuf_len(ptrcbuffer);
+    }
+}
+
+static inline void cbuf_stat_get(struct cbuf *ptrcbuffer, unsigned int want, unsigned int done)
+{
+    ptrcbuffer->stats.gets += done;
+    ptrcbuffer->stats.empty += done < want;
+}
+
+static inline void cbuf_stat_compact(struct cbuf *ptrcbuffer, unsigned int nbytes)
+{
+    ptrcbuffer->stats.compacted += nbytes;
+}
+
+static inline void cbuf_stat_resize(struct cbuf *ptrcbuffer, unsigned int nbytes)
+{
+    ptrcbuffer->stats.resized += nbytes;
+}
+
+static inline void cbuf_stat_reset(struct cbuf *ptrcbuffer)
+{
+    cbuf_stats_reset(ptrcbuffer);
+}
+#else
+#define cbuf_stat_put(ptrcbuffer, want, done)
+#define cbuf_stat_get(ptrcbuffer, want, done)
+#define cbuf_stat_compact(ptrcbuffer, nbytes)
+#define cbuf_stat_resize(ptrcbuffer, nbytes)
+#define cbuf_stat_reset(ptrcbuffer)
+#endif
+
 int cbuf_init(struct cbuf *ptrcbuffer, void *buffer, unsigned int size, size_t esize)
 {
     size /= esize;
@@ -46,39 +97,162 @@ int cbuf_init(struct cbuf *ptrcbuffer, void *buffer, unsigned int size, size_t e
     ptrcbuffer->esize = esize;
     ptrcbuffer->ecount = size;
     ptrcbuffer->buf = buffer;
+    ptrcbuffer->pool = NULL;
+    ptrcbuffer->wpart = 0;
+    ptrcbuffer->rpart = 0;
+    ptrcbuffer->minsize = 0;
+    ptrcbuffer->lowcount = 0;
+    cbuf_stat_reset(ptrcbuffer);
 
     return 0;
 }
 
-int cbuf_alloc(struct cbuf *ptrcbuffer, unsigned int ecount, size_t esize)
+static inline void *cbuf_storage_alloc(struct mempool *pool, size_t nbytes)
 {
-    if (ecount == 0)
+    return pool ? mempool_alloc(pool, nbytes) : malloc(nbytes);
+}
+
+static inline void cbuf_storage_free(struct mempool *pool, void *p)
+{
+    if (pool)
+    {
+        mempool_free(pool, p);
+    }
+    else
+    {
+        free(p);
+    }
+}
+
+int cbuf_alloc_pool(struct cbuf *ptrcbuffer, struct mempool *pool, unsigned int ecount, size_t esize)
+{
+    /* raw positions are unsigned int bytes */
+    if (ecount == 0 || esize == 0 || ecount > UINT_MAX / esize)
     {
         ptrcbuffer->ecount = 0;
         return -1;
     }
 
-    ptrcbuffer->buf = malloc(ecount * esize);
-    if (ptrcbuffer->buf == NULL)
+    void *buf = cbuf_storage_alloc(pool, ecount * esize);
+    if (buf == NULL)
     {
         return -1;
     }
 
+    ptrcbuffer->buf = buf;
     ptrcbuffer->wpos = 0;
     ptrcbuffer->rpos = 0;
     ptrcbuffer->esize = esize;
     ptrcbuffer->ecount = ecount;
+    ptrcbuffer->pool = pool;
+    ptrcbuffer->wpart = 0;
+    ptrcbuffer->rpart = 0;
+    ptrcbuffer->minsize = ecount;
+    ptrcbuffer->lowcount = 0;
+    cbuf_stat_reset(ptrcbuffer);
 
     return 0;
 }
 
+int cbuf_alloc(struct cbuf *ptrcbuffer, unsigned int ecount, size_t esize)
+{
+    return cbuf_alloc_pool(ptrcbuffer, NULL, ecount, esize);
+}
+
 int cbuf_free(struct cbuf *ptrcbuffer)
 {
-    free(ptrcbuffer->buf);
+    cbuf_storage_free(ptrcbuffer->pool, ptrcbuffer->buf);
     ptrcbuffer->wpos = 0;
     ptrcbuffer->rpos = 0;
     ptrcbuffer->esize = 0;
     ptrcbuffer->ecount = 0;
+    ptrcbuffer->wpart = 0;
+    ptrcbuffer->rpart = 0;
+    ptrcbuffer->pool = NULL;
+    ptrcbuffer->minsize = 0;
+    ptrcbuffer->lowcount = 0;
+    return 0;
+}
+
+/*
+ * move the buffer to new storage of ecount elements,
+ * the unread elements are copied once to the front of new storage.
+ * only buffers from cbuf_alloc or cbuf_alloc_pool can be resized.
+ */
+int cbuf_resize(struct cbuf *ptrcbuffer, unsigned int ecount)
+{
+    if (ptrcbuffer->minsize == 0 || ecount == 0 || ecount < cbuf_len(ptrcbuffer) + (ptrcbuffer->wpart != 0) ||
+        ecount > UINT_MAX / cbuf_element_size(ptrcbuffer))
+    {
+        return -1;
+    }
+
+    void *buf = cbuf_storage_alloc(ptrcbuffer->pool, ecount * cbuf_element_size(ptrcbuffer));
+    if (buf == NULL)
+    {
+        return -1;
+    }
+
+    unsigned int len = cbuf_len(ptrcbuffer);
+    /* bytes of a partial element from cbuf_fill_from_fd go along */
+    memcpy(buf, cbuf_rawget_pos(ptrcbuffer), cbuf_rawlen(ptrcbuffer) + ptrcbuffer->wpart);
+    cbuf_stat_resize(ptrcbuffer, cbuf_rawlen(ptrcbuffer));
+    cbuf_storage_free(ptrcbuffer->pool, ptrcbuffer->buf);
+
+    ptrcbuffer->buf = buf;
+    ptrcbuffer->ecount = ecount;
+    cbuf_get_pos(ptrcbuffer) = 0;
+    cbuf_put_pos(ptrcbuffer) = len;
+    ptrcbuffer->lowcount = 0;
+
+    return 0;
+}
+
+/*
+ * call periodically, e.g. once per batch or event loop round.
+ * double the size when unread elements reach CBUF_HIGH_WATERMARK,
+ * move them to the front when only the free space is running out,
+ * halve it after CBUF_SHRINK_DELAY checks in a row below CBUF_LOW_WATERMARK,
+ * never below the size given at alloc.
+ * return 1 if resized, 0 if not, -1 on error.
+ */
+int cbuf_autoresize(struct cbuf *ptrcbuffer)
+{
+    unsigned long used = (unsigned long)cbuf_len(ptrcbuffer) * 100;
+    unsigned long size = cbuf_size(ptrcbuffer);
+
+    if (ptrcbuffer->minsize == 0)
+    {
+        return -1;
+    }
+
+    if (used >= size * CBUF_HIGH_WATERMARK)
+    {
+        if (size > UINT_MAX / 2)
+        {
+            return -1;
+        }
+        return cbuf_resize(ptrcbuffer, size * 2) ? -1 : 1;
+    }
+
+    /* unread elements are few but pushed to the end, move them to the front */
+    if ((unsigned long)cbuf_avail(ptrcbuffer) * 100 < size * (100 - CBUF_HIGH_WATERMARK))
+    {
+        cbuf_compact(ptrcbuffer);
+    }
+
+    if (used >= size * CBUF_LOW_WATERMARK || size / 2 < ptrcbuffer->minsize)
+    {
+        ptrcbuffer->lowcount = 0;
+        return 0;
+    }
+
+    if (++ptrcbuffer->lowcount < CBUF_SHRINK_DELAY)
+    {
+        return 0;
+    }
+
+    return cbuf_resize(ptrcbuffer, size / 2) ? -1 : 1;
 }
 
 int cbuf_compact(struct cbuf *ptrcbuffer)
@@ -87,56 +261,79 @@ int cbuf_compact(struct cbuf *ptrcbuffer)
     {
         return -1;
     }
-    unsigned int size = cbuf_rawavail(ptrcbuffer);
-    memmove(cbuf_raw(ptrcbuffer), cbuf_rawget_pos(ptrcbuffer), size);
+    unsigned int len = cbuf_len(ptrcbuffer);
+    memmove(cbuf_raw(ptrcbuffer), cbuf_rawget_pos(ptrcbuffer), cbuf_rawlen(ptrcbuffer) + ptrcbuffer->wpart);
+    cbuf_stat_compact(ptrcbuffer, cbuf_rawlen(ptrcbuffer));
     cbuf_get_pos(ptrcbuffer) = 0;
-    cbuf_put_pos(ptrcbuffer) = size;
+    cbuf_put_pos(ptrcbuffer) = len;
     return 0;
 }
 
 unsigned int cbuf_put(struct cbuf *ptrcbuffer, const void *buf)
 {
-    if (cbuf_avail(ptrcbuffer))
+    /* a partial element from cbuf_fill_from_fd holds the put position */
+    if (cbuf_avail(ptrcbuffer) && !ptrcbuffer->wpart)
     {
         memcpy(cbuf_rawput_pos(ptrcbuffer), buf, cbuf_element_size(ptrcbuffer));
         cbuf_put_pos(ptrcbuffer)++;
+        cbuf_stat_put(ptrcbuffer, 1, 1);
         return 1;
     }
+    cbuf_stat_put(ptrcbuffer, 1, 0);
     return 0;
 }
 
 unsigned int cbuf_write(struct cbuf *ptrcbuffer, const void *buf, unsigned int ecount)
 {
-    if (cbuf_avail(ptrcbuffer) < ecount)
+#ifdef CBUF_STATS
+    unsigned int want = ecount;
+#endif
+    if (ptrcbuffer->wpart)
+    {
+        ecount = 0;
+    }
+    else if (cbuf_avail(ptrcbuffer) < ecount)
     {
         ecount = cbuf_avail(ptrcbuffer);
     }
     memcpy(cbuf_rawput_pos(ptrcbuffer), buf, cbuf_element_size(ptrcbuffer) * ecount);
     cbuf_put_pos(ptrcbuffer) += ecount;
+    cbuf_stat_put(ptrcbuffer, want, ecount);
     return ecount;
 }
 
 unsigned int cbuf_get(struct cbuf *ptrcbuffer, void *buf)
 {
-    if (cbuf_len(ptrcbuffer))
+    /* the element at get position is partly written by cbuf_drain_to_fd */
+    if (cbuf_len(ptrcbuffer) && !ptrcbuffer->rpart)
     {
         memcpy(buf, cbuf_rawget_pos(ptrcbuffer), cbuf_element_size(ptrcbuffer));
-        memset(cbuf_rawget_pos(ptrcbuffer), 0, cbuf_element_size(ptrcbuffer));
+        cbuf_clear(cbuf_rawget_pos(ptrcbuffer), cbuf_element_size(ptrcbuffer));
         cbuf_get_pos(ptrcbuffer)++;
+        cbuf_stat_get(ptrcbuffer, 1, 1);
         return 1;
     }
+    cbuf_stat_get(ptrcbuffer, 1, 0);
     return 0;
 }
 
 unsigned int cbuf_read(struct cbuf *ptrcbuffer, void *buf, unsigned int ecount)
 {
-    if (cbuf_len(ptrcbuffer) < ecount)
+#ifdef CBUF_STATS
+    unsigned int want = ecount;
+#endif
+    if (ptrcbuffer->rpart)
+    {
+        ecount = 0;
+    }
+    else if (cbuf_len(ptrcbuffer) < ecount)
     {
         ecount = cbuf_len(ptrcbuffer);
     }
     memcpy(buf, cbuf_rawget_pos(ptrcbuffer), cbuf_element_size(ptrcbuffer) * ecount);
-    memset(cbuf_rawget_pos(ptrcbuffer), 0, cbuf_element_size(ptrcbuffer) * ecount);
+    cbuf_clear(cbuf_rawget_pos(ptrcbuffer), cbuf_element_size(ptrcbuffer) * ecount);
     cbuf_get_pos(ptrcbuffer) += ecount;
+    cbuf_stat_get(ptrcbuffer, want, ecount);
     return ecount;
 }
 
@@ -147,3 +344,94 @@ unsigned int cbuf_peek(struct cbuf *ptrcbuffer, void *buf)
         memcpy(buf, cbuf_rawget_pos(ptrcbuffer), cbuf_element_size(ptrcbuffer));
     }
 }
+
+/*
+ * read from fd straight into the free space after put position.
+ * only whole elements are committed, the bytes of a partial element are
+ * kept after put position (wpart) and completed by the next call,
+ * cbuf_put/cbuf_write put nothing until then.
+ * return elements added, 0 on end of file or full,
+ * -1 on error (errno set, EAGAIN also when only part of an element arrived).
+ */
+ssize_t cbuf_fill_from_fd(struct cbuf *ptrcbuffer, int fd)
+{
+    struct iovec iov;
+    ssize_t n;
+    size_t got;
+
+    if (cbuf_avail(ptrcbuffer) == 0)
+    {
+        cbuf_stat_put(ptrcbuffer, 1, 0);
+        return 0;
+    }
+    iov.iov_base = (char *)cbuf_rawput_pos(ptrcbuffer) + ptrcbuffer->wpart;
+    iov.iov_len = cbuf_rawavail(ptrcbuffer) - ptrcbuffer->wpart;
+
+    do
+    {
+        n = readv(fd, &iov, 1);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+    {
+        return n;
+    }
+
+    got = ptrcbuffer->wpart + n;
+    ptrcbuffer->wpart = got % cbuf_element_size(ptrcbuffer);
+    got /= cbuf_element_size(ptrcbuffer);
+    if (got == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    cbuf_put_pos(ptrcbuffer) += got;
+    cbuf_stat_put(ptrcbuffer, got, got);
+    return got;
+}
+
+/*
+ * write the readable elements from get position straight to fd.
+ * like cbuf_read, the written elements are cleared. the bytes of the
+ * element at get position already written are counted (rpart),
+ * the next call continues after them, cbuf_get/cbuf_read get nothing until then.
+ * return elements removed, 0 if empty,
+ * -1 on error (errno set, EAGAIN also when only part of an element went out).
+ */
+ssize_t cbuf_drain_to_fd(struct cbuf *ptrcbuffer, int fd)
+{
+    struct iovec iov;
+    ssize_t n;
+    size_t put;
+
+    if (cbuf_len(ptrcbuffer) == 0)
+    {
+        cbuf_stat_get(ptrcbuffer, 1, 0);
+        return 0;
+    }
+    iov.iov_base = (char *)cbuf_rawget_pos(ptrcbuffer) + ptrcbuffer->rpart;
+    iov.iov_len = cbuf_rawlen(ptrcbuffer) - ptrcbuffer->rpart;
+
+    do
+    {
+        n = writev(fd, &iov, 1);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+    {
+        return n;
+    }
+
+    put = ptrcbuffer->rpart + n;
+    ptrcbuffer->rpart = put % cbuf_element_size(ptrcbuffer);
+    put /= cbuf_element_size(ptrcbuffer);
+    if (put == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    cbuf_clear(cbuf_rawget_pos(ptrcbuffer), put * cbuf_element_size(ptrcbuffer));
+    cbuf_get_pos(ptrcbuffer) += put;
+    cbuf_stat_get(ptrcbuffer, put, put);
+    return put;
+}
@@ -2,16 +2,54 @@
 #define C_LIB_CBUF_H_
 
 #include <stddef.h>
+#include <sys/types.h>
+#ifdef CBUF_STATS
+#include <string.h>
+#endif
+
+struct mempool;
+
+#ifdef CBUF_STATS
+struct cbuf_stats
+{
+    unsigned long puts;      /* elements put */
+    unsigned long gets;      /* elements got */
+    unsigned long full;      /* puts/writes cut short by no space */
+    unsigned long empty;     /* gets/reads cut short by no element */
+    unsigned long compacted; /* bytes moved to the front by compaction */
+    unsigned long resized;   /* bytes copied to new storage by resize */
+    unsigned int peak;       /* max elements held */
+};
+#endif
 
 struct cbuf
 {
-    unsigned int wpos;   /* next write position */
-    unsigned int rpos;   /* next read position */
-    unsigned int ecount; /* elements count */
-    unsigned int esize;  /* sizeof(Element) */
-    void *buf;           /* elements data buffer */
+    unsigned int wpos;     /* next write position */
+    unsigned int rpos;     /* next read position */
+    unsigned int ecount;   /* elements count */
+    unsigned int esize;    /* sizeof(Element) */
+    void *buf;             /* elements data buffer */
+    unsigned int wpart;    /* bytes of a partial element read from fd at wpos */
+    unsigned int rpart;    /* bytes of the element at rpos already written to fd */
+    struct mempool *pool;  /* buf is from this pool, NULL for malloc */
+    unsigned int minsize;  /* shrink floor, 0 if buf is not resizable */
+    unsigned int lowcount; /* consecutive low occupancy autoresize checks */
+#ifdef CBUF_STATS
+    struct cbuf_stats stats; /* hot path counters */
+#endif
 };
 
+/* occupancy percents and delay used by cbuf_autoresize */
+#ifndef CBUF_HIGH_WATERMARK
+#define CBUF_HIGH_WATERMARK 75
+#endif
+#ifndef CBUF_LOW_WATERMARK
+#define CBUF_LOW_WATERMARK 25
+#endif
+#ifndef CBUF_SHRINK_DELAY
+#define CBUF_SHRINK_DELAY 16
+#endif
+
 #define cbuf_put_pos(ptrcbuffer) ((ptrcbuffer)->wpos)
 #define cbuf_get_pos(ptrcbuffer) ((ptrcbuffer)->rpos)
 #define cbuf_size(ptrcbuffer) ((ptrcbuffer)->ecount)
@@ -19,13 +57,18 @@ struct cbuf
 
 extern int cbuf_init(struct cbuf *ptrcbuffer, void *buffer, unsigned int size, size_t esize);
 extern int cbuf_alloc(struct cbuf *ptrcbuffer, unsigned int ecount, size_t esize);
+extern int cbuf_alloc_pool(struct cbuf *ptrcbuffer, struct mempool *pool, unsigned int ecount, size_t esize);
 extern int cbuf_free(struct cbuf *ptrcbuffer);
+extern int cbuf_resize(struct cbuf *ptrcbuffer, unsigned int ecount);
+extern int cbuf_autoresize(struct cbuf *ptrcbuffer);
 extern int cbuf_compact(struct cbuf *ptrcbuffer);
 extern unsigned int cbuf_put(struct cbuf *ptrcbuffer, const void *buf);
 extern unsigned int cbuf_write(struct cbuf *ptrcbuffer, const void *buf, unsigned int ecount);
 extern unsigned int cbuf_get(struct cbuf *ptrcbuffer, void *buf);
 extern unsigned int cbuf_read(struct cbuf *ptrcbuffer, void *buf, unsigned int ecount);
 extern unsigned int cbuf_peek(struct cbuf *ptrcbuffer, void *buf);
+extern ssize_t cbuf_fill_from_fd(struct cbuf *ptrcbuffer, int fd);
+extern ssize_t cbuf_drain_to_fd(struct cbuf *ptrcbuffer, int fd);
 
 #define cbuf_avail(ptrcbuffer) (cbuf_size(ptrcbuffer) - cbuf_put_pos(ptrcbuffer))
 
@@ -34,8 +77,15 @@ extern unsigned int cbuf_peek(struct cbuf *ptrcbuffer, void *buf);
 #define cbuf_reset(ptrcbuffer) ({ \
     cbuf_put_pos(ptrcbuffer) = 0; \
     cbuf_get_pos(ptrcbuffer) = 0; \
+    (ptrcbuffer)->wpart = 0; \
+    (ptrcbuffer)->rpart = 0; \
 })
 
 #define cbuf_is_empty(ptrcbuffer) (cbuf_put_pos(ptrcbuffer) == cbuf_get_pos(ptrcbuffer))
 
+#ifdef CBUF_STATS
+#define cbuf_stats(ptrcbuffer) (&(ptrcbuffer)->stats)
+#define cbuf_stats_reset(ptrcbuffer) memset(cbuf_stats(ptrcbuffer), 0, sizeof(struct cbuf_stats))
+#endif
+
 #endif
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+extern "C"
+{
+#include <bcbuf/bcbuf.h>
+}
+
+const unsigned int ecount = 8;
+const unsigned int nreaders = 3;
+
+class bcbufTest : public ::testing::Test
+{
+protected:
+    bcbufTest() {}
+    virtual ~bcbufTest() {}
+    virtual void SetUp() override
+    {
+        bcbuf_alloc(&mybcbuf, ecount, sizeof(int), nreaders, 0);
+    }
+    virtual void TearDown() override
+    {
+        bcbuf_free(&mybcbuf);
+    }
+
+    struct bcbuf mybcbuf;
+
+    /* read all elements visible to reader through peek/release */
+    std::vector<int> drain(struct bcbuf_reader *reader)
+    {
+        std::vector<int> out;
+        const void *slot;
+        unsigned int n;
+        while ((n = bcbuf_peek(&mybcbuf, reader, &slot)))
+        {
+            out.insert(out.end(), (const int *)slot, (const int *)slot + n);
+            bcbuf_release(&mybcbuf, reader, n);
+        }
+        return out;
+    }
+};
+
+TEST(bcbufAllocTest, Alloc)
+{
+    struct bcbuf mybcbuf;
+
+    ASSERT_EQ(bcbuf_alloc(&mybcbuf, 0, sizeof(int), 1, 0), -1);
+    ASSERT_EQ(bcbuf_alloc(&mybcbuf, 6, sizeof(int), 1, 0), -1);
+    ASSERT_EQ(bcbuf_alloc(&mybcbuf, 8, sizeof(int), 0, 0), -1);
+    ASSERT_EQ(bcbuf_alloc(&mybcbuf, 8, sizeof(int), 1, 8), -1);
+    ASSERT_EQ(bcbuf_alloc(&mybcbuf, 2, SIZE_MAX / 2 + 1, 1, 0), -1);
+    if (SIZE_MAX / sizeof(struct bcbuf_reader) < UINT_MAX)
+    {
+        ASSERT_EQ(bcbuf_alloc(&mybcbuf, 8, sizeof(int), UINT_MAX, 0), -1);
+    }
+    if (SIZE_MAX > UINT_MAX)
+    {
+        ASSERT_EQ(bcbuf_alloc(&mybcbuf, 1, (size_t)UINT_MAX + 1, 1, 0), -1);
+    }
+    ASSERT_EQ(bcbuf_alloc(&mybcbuf, 8, sizeof(int), 2, 4), 0);
+    ASSERT_EQ(bcbuf_size(&mybcbuf), 8);
+    ASSERT_EQ(bcbuf_element_size(&mybcbuf), sizeof(int));
+    bcbuf_free(&mybcbuf);
+}
+
+TEST_F(bcbufTest, Readers)
+{
+    struct bcbuf_reader *r[nreaders];
+    for (unsigned int i = 0; i < nreaders; i++)
+    {
+        r[i] = bcbuf_reader_add(&mybcbuf);
+        ASSERT_NE(r[i], nullptr);
+        ASSERT_EQ((uintptr_t)r[i] % BCBUF_CACHELINE, 0);
+    }
+    ASSERT_EQ(bcbuf_reader_add(&mybcbuf), nullptr);
+    ASSERT_EQ((uintptr_t)&mybcbuf.wseq % BCBUF_CACHELINE, 0);
+
+    ASSERT_EQ(bcbuf_reader_remove(&mybcbuf, r[1]), 0);
+    ASSERT_EQ(bcbuf_reader_add(&mybcbuf), r[1]);
+
+    struct bcbuf_reader other;
+    ASSERT_EQ(bcbuf_reader_remove(&mybcbuf, &other), -1);
+}
+
+TEST_F(bcbufTest, Broadcast)
+{
+    struct bcbuf_reader *r1 = bcbuf_reader_add(&mybcbuf);
+    struct bcbuf_reader *r2 = bcbuf_reader_add(&mybcbuf);
+
+    int e[5] = {1, 2, 3, 4, 5};
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e, 3), 3);
+    ASSERT_EQ(bcbuf_put(&mybcbuf, e + 3), 1);
+
+    const void *slot;
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, r1, &slot), 4);
+    ASSERT_EQ(*(const int *)slot, 1);
+    ASSERT_EQ(bcbuf_release(&mybcbuf, r1, 1), 0);
+    ASSERT_THAT(drain(r1), ::testing::ElementsAre(2, 3, 4));
+
+    /* late reader only sees what comes after it joined */
+    struct bcbuf_reader *r3 = bcbuf_reader_add(&mybcbuf);
+    ASSERT_EQ(bcbuf_put(&mybcbuf, e + 4), 1);
+
+    ASSERT_THAT(drain(r1), ::testing::ElementsAre(5));
+    ASSERT_THAT(drain(r2), ::testing::ElementsAre(1, 2, 3, 4, 5));
+    ASSERT_THAT(drain(r3), ::testing::ElementsAre(5));
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, r2, &slot), 0);
+}
+
+TEST_F(bcbufTest, GatedBySlowest)
+{
+    struct bcbuf_reader *fast = bcbuf_reader_add(&mybcbuf);
+    struct bcbuf_reader *slow = bcbuf_reader_add(&mybcbuf);
+
+    int e[ecount + 2];
+    for (unsigned int i = 0; i < ecount + 2; i++)
+    {
+        e[i] = i;
+    }
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e, ecount + 2), ecount);
+    ASSERT_EQ(bcbuf_put(&mybcbuf, e), 0);
+
+    drain(fast);
+    ASSERT_EQ(bcbuf_put(&mybcbuf, e), 0);
+
+    const void *slot;
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, slow, &slot), ecount);
+    bcbuf_release(&mybcbuf, slow, 2);
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e + ecount, 2), 2);
+    ASSERT_EQ(bcbuf_put(&mybcbuf, e), 0);
+
+    /* a removed reader no longer holds the writer */
+    bcbuf_reader_remove(&mybcbuf, slow);
+    drain(fast);
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e, ecount), ecount);
+}
+
+TEST_F(bcbufTest, ReleaseTooMany)
+{
+    struct bcbuf_reader *r = bcbuf_reader_add(&mybcbuf);
+
+    int e[ecount] = {};
+    bcbuf_write(&mybcbuf, e, 3);
+
+    ASSERT_EQ(bcbuf_release(&mybcbuf, r, 4), -1);
+    ASSERT_EQ(bcbuf_release(&mybcbuf, r, 3), 0);
+    ASSERT_EQ(bcbuf_release(&mybcbuf, r, 1), -1);
+
+    /* the writer still may not pass the reader */
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e, ecount), ecount);
+    ASSERT_EQ(bcbuf_put(&mybcbuf, e), 0);
+}
+
+TEST_F(bcbufTest, SequenceWrap)
+{
+    /* start close to the end of the sequence range */
+    mybcbuf.wseq = (unsigned long)-4;
+    mybcbuf.gate = mybcbuf.wseq;
+    struct bcbuf_reader *slow = bcbuf_reader_add(&mybcbuf);
+
+    int e[ecount] = {1, 2, 3, 4, 5, 6, 7, 8};
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e, 6), 6);
+    struct bcbuf_reader *fast = bcbuf_reader_add(&mybcbuf);
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e + 6, 2), 2);
+    drain(fast);
+
+    /* slow holds the writer across the wrap */
+    ASSERT_EQ(bcbuf_put(&mybcbuf, e), 0);
+    ASSERT_THAT(drain(slow), ::testing::ElementsAre(1, 2, 3, 4, 5, 6, 7, 8));
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e, ecount), ecount);
+}
+
+TEST_F(bcbufTest, Wrap)
+{
+    struct bcbuf_reader *r = bcbuf_reader_add(&mybcbuf);
+
+    int e[ecount];
+    for (unsigned int i = 0; i < ecount; i++)
+    {
+        e[i] = i;
+    }
+    bcbuf_write(&mybcbuf, e, 6);
+    drain(r);
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e, 5), 5);
+
+    const void *slot;
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, r, &slot), 2);
+    ASSERT_THAT(std::vector<int>((const int *)slot, (const int *)slot + 2), ::testing::ElementsAre(0, 1));
+    bcbuf_release(&mybcbuf, r, 2);
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, r, &slot), 3);
+    ASSERT_EQ(slot, mybcbuf.buf);
+    ASSERT_THAT(std::vector<int>((const int *)slot, (const int *)slot + 3), ::testing::ElementsAre(2, 3, 4));
+}
+
+TEST(bcbufLagTest, Lapped)
+{
+    struct bcbuf mybcbuf;
+    bcbuf_alloc(&mybcbuf, 8, sizeof(int), 2, 4);
+    struct bcbuf_reader *fast = bcbuf_reader_add(&mybcbuf);
+    struct bcbuf_reader *slow = bcbuf_reader_add(&mybcbuf);
+
+    int e[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e, 8), 4);
+    const void *slot;
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, slow, &slot), 4);
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, fast, &slot), 4);
+    bcbuf_release(&mybcbuf, fast, 4);
+
+    /* the writer does not wait for slow */
+    ASSERT_EQ(bcbuf_write(&mybcbuf, e + 4, 4), 4);
+    ASSERT_FALSE(bcbuf_is_lapped(fast));
+    ASSERT_EQ(bcbuf_release(&mybcbuf, slow, 4), -1);
+    ASSERT_TRUE(bcbuf_is_lapped(slow));
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, slow, &slot), 0);
+
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, fast, &slot), 4);
+    ASSERT_THAT(std::vector<int>((const int *)slot, (const int *)slot + 4), ::testing::ElementsAre(4, 5, 6, 7));
+    ASSERT_EQ(bcbuf_release(&mybcbuf, fast, 4), 0);
+
+    bcbuf_reader_resync(&mybcbuf, slow);
+    ASSERT_FALSE(bcbuf_is_lapped(slow));
+    ASSERT_EQ(bcbuf_put(&mybcbuf, e), 1);
+    ASSERT_EQ(bcbuf_peek(&mybcbuf, slow, &slot), 1);
+    ASSERT_EQ(*(const int *)slot, 0);
+
+    bcbuf_free(&mybcbuf);
+}
+
+TEST_F(bcbufTest, Threads)
+{
+    const unsigned int total = 100000;
+    struct bcbuf_reader *r[nreaders];
+    for (unsigned int i = 0; i < nreaders; i++)
+    {
+        r[i] = bcbuf_reader_add(&mybcbuf);
+    }
+
+    std::vector<std::thread> threads;
+    unsigned long sums[nreaders] = {};
+    bool ordered[nreaders] = {};
+    for (unsigned int i = 0; i < nreaders; i++)
+    {
+        threads.emplace_back([&, i]() {
+            unsigned int expect = 0;
+            ordered[i] = true;
+            while (expect < total)
+            {
+                const void *slot;
+                unsigned int n = bcbuf_peek(&mybcbuf, r[i], &slot);
+                if (n == 0)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (unsigned int k = 0; k < n; k++)
+                {
+                    int v = ((const int *)slot)[k];
+                    ordered[i] = ordered[i] && v == (int)expect;
+                    sums[i] += v;
+                    expect++;
+                }
+                bcbuf_release(&mybcbuf, r[i], n);
+            }
+        });
+    }
+
+    for (unsigned int i = 0; i < total;)
+    {
+        int v = i;
+        if (bcbuf_put(&mybcbuf, &v))
+        {
+            i++;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    for (unsigned int i = 0; i < nreaders; i++)
+    {
+        ASSERT_TRUE(ordered[i]);
+        ASSERT_EQ(sums[i], (unsigned long)total * (total - 1) / 2);
+    }
+}
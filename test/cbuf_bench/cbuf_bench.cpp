@@ -0,0 +1,229 @@
+/*
+ * cbuf throughput and latency benchmark.
+ *
+ * sweeps element size, batch size and fill level, each round writes one
+ * batch and reads it back so the fill level stays put. batch 1 goes through
+ * cbuf_put/cbuf_get, larger batches through cbuf_write/cbuf_read.
+ * cbuf_compact is called when the free space runs out.
+ *
+ * msgs/s and bytes/s come from one pass timed as a whole (put+get rows).
+ * latency percentiles come from a second pass where every put/write,
+ * get/read and compact call is timed on its own, less the cost of an
+ * empty clock pair measured at start.
+ *
+ * build both files with -DCBUF_NO_CLEAR to see the cost of clearing read elements,
+ * with -DCBUF_STATS to also print the built-in counters.
+ *
+ *   gcc -O2 -c -Ilib lib/cbuf/cbuf.c lib/mempool/mempool.c
+ *   g++ -O2 -Ilib test/cbuf_bench/cbuf_bench.cpp cbuf.o mempool.o -o cbuf_bench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+extern "C"
+{
+#include <cbuf/cbuf.h>
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+const unsigned int capacity = 4096;
+const unsigned int rounds = 200000;
+const unsigned int esizes[] = {4, 16, 64, 256};
+const unsigned int batches[] = {1, 8, 64};
+const unsigned int fills[] = {0, 50, 90};
+
+static unsigned long nsec(bench_clock::time_point from, bench_clock::time_point to)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+static unsigned long percentile(std::vector<unsigned long> &lat, double p)
+{
+    if (lat.empty())
+    {
+        return 0;
+    }
+    size_t i = (size_t)(p * (lat.size() - 1));
+    std::nth_element(lat.begin(), lat.begin() + i, lat.end());
+    return lat[i];
+}
+
+static unsigned long timer_cost;
+
+/* p50 of an empty clock pair */
+static void measure_timer_cost()
+{
+    std::vector<unsigned long> lat(10000);
+    for (unsigned long &t : lat)
+    {
+        bench_clock::time_point t0 = bench_clock::now();
+        bench_clock::time_point t1 = bench_clock::now();
+        t = nsec(t0, t1);
+    }
+    timer_cost = percentile(lat, 0.50);
+}
+
+/* msgs < 0 prints no throughput, empty lat prints no latency */
+static void report(const char *op, unsigned int esize, unsigned int batch, unsigned int fill,
+                   double msgs, std::vector<unsigned long> &lat)
+{
+    printf("%-10s %6u %6u %5u%%", op, esize, batch, fill);
+    if (msgs < 0)
+    {
+        printf(" %14s %14s", "-", "-");
+    }
+    else
+    {
+        printf(" %14.0f %14.0f", msgs, msgs * esize);
+    }
+    if (lat.empty())
+    {
+        printf(" %8s %8s %8s\n", "-", "-", "-");
+    }
+    else
+    {
+        printf(" %8lu %8lu %8lu\n", percentile(lat, 0.50), percentile(lat, 0.99), percentile(lat, 0.999));
+    }
+}
+
+/* clock pair time less its own cost */
+static inline unsigned long elapsed(bench_clock::time_point t0, bench_clock::time_point t1)
+{
+    unsigned long ns = nsec(t0, t1);
+    return ns > timer_cost ? ns - timer_cost : 0;
+}
+
+static inline void put_batch(struct cbuf *mycbuf, unsigned int batch, char *in)
+{
+    if (batch == 1)
+    {
+        cbuf_put(mycbuf, in);
+    }
+    else
+    {
+        cbuf_write(mycbuf, in, batch);
+    }
+}
+
+static inline void get_batch(struct cbuf *mycbuf, unsigned int batch, char *out)
+{
+    if (batch == 1)
+    {
+        cbuf_get(mycbuf, out);
+    }
+    else
+    {
+        cbuf_read(mycbuf, out, batch);
+    }
+}
+
+static void bench(unsigned int esize, unsigned int batch, unsigned int fill)
+{
+    struct cbuf mycbuf;
+    if (cbuf_alloc(&mycbuf, capacity, esize))
+    {
+        fprintf(stderr, "cbuf_alloc failed\n");
+        exit(1);
+    }
+
+    std::vector<char> in(batch * esize, 1);
+    std::vector<char> out(batch * esize);
+    std::vector<unsigned long> none, wlat, rlat, clat;
+    wlat.reserve(rounds);
+    rlat.reserve(rounds);
+
+    /* keep the fill level, leaving room for one batch */
+    unsigned int prefill = std::min(capacity * fill / 100, capacity - batch);
+    for (unsigned int i = 0; i < prefill; i++)
+    {
+        cbuf_put(&mycbuf, in.data());
+    }
+#ifdef CBUF_STATS
+    cbuf_stats_reset(&mycbuf);
+#endif
+
+    /* throughput, no clock inside the loop */
+    bench_clock::time_point t0 = bench_clock::now();
+    for (unsigned int i = 0; i < rounds; i++)
+    {
+        if (cbuf_avail(&mycbuf) < batch)
+        {
+            cbuf_compact(&mycbuf);
+        }
+        put_batch(&mycbuf, batch, in.data());
+        get_batch(&mycbuf, batch, out.data());
+    }
+    bench_clock::time_point t1 = bench_clock::now();
+    double msgs = (double)rounds * batch / (nsec(t0, t1) / 1e9);
+
+    /* latency, every call timed alone */
+    for (unsigned int i = 0; i < rounds; i++)
+    {
+        if (cbuf_avail(&mycbuf) < batch)
+        {
+            t0 = bench_clock::now();
+            cbuf_compact(&mycbuf);
+            t1 = bench_clock::now();
+            clat.push_back(elapsed(t0, t1));
+        }
+
+        t0 = bench_clock::now();
+        put_batch(&mycbuf, batch, in.data());
+        t1 = bench_clock::now();
+        wlat.push_back(elapsed(t0, t1));
+
+        t0 = bench_clock::now();
+        get_batch(&mycbuf, batch, out.data());
+        t1 = bench_clock::now();
+        rlat.push_back(elapsed(t0, t1));
+    }
+
+    unsigned long compact_total = 0;
+    for (unsigned long t : clat)
+    {
+        compact_total += t;
+    }
+    double compact_msgs = compact_total ? clat.size() * prefill / (compact_total / 1e9) : 0;
+
+    report(batch == 1 ? "put+get" : "write+read", esize, batch, fill, msgs, none);
+    report(batch == 1 ? "put" : "write", esize, batch, fill, -1, wlat);
+    report(batch == 1 ? "get" : "read", esize, batch, fill, -1, rlat);
+    report("compact", esize, batch, fill, compact_msgs, clat);
+
+#ifdef CBUF_STATS
+    struct cbuf_stats *stats = cbuf_stats(&mycbuf);
+    printf("           puts %lu gets %lu full %lu empty %lu compacted %lu bytes resized %lu bytes peak %u\n",
+           stats->puts, stats->gets, stats->full, stats->empty, stats->compacted, stats->resized, stats->peak);
+#endif
+
+    cbuf_free(&mycbuf);
+}
+
+int main()
+{
+#ifdef CBUF_NO_CLEAR
+    printf("clear on read: off\n");
+#else
+    printf("clear on read: on\n");
+#endif
+    measure_timer_cost();
+    printf("clock pair: %lu ns\n", timer_cost);
+    printf("%-10s %6s %6s %6s %14s %14s %8s %8s %8s\n",
+           "op", "esize", "batch", "fill", "msgs/s", "bytes/s", "p50 ns", "p99 ns", "p999 ns");
+
+    for (unsigned int esize : esizes)
+    {
+        for (unsigned int batch : batches)
+        {
+            for (unsigned int fill : fills)
+            {
+                bench(esize, batch, fill);
+            }
+        }
+    }
+    return 0;
+}
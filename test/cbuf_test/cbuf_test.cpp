@@ -1,10 +1,15 @@
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
 extern "C"
 {
 #include <cbuf/cbuf.h>
+#include <mempool/mempool.h>
 }
 
 const static unsigned int bsize = 128;
@@ -215,3 +220,474 @@ TEST_F(cbufTest, Full)
     ASSERT_EQ(cbuf_len(&mycbuf), ecount);
     ASSERT_EQ(cbuf_avail(&mycbuf), 0);
 }
+
+TEST_F(cbufTest, Compact)
+{
+    int e[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    int out[8];
+
+    ASSERT_EQ(cbuf_compact(&mycbuf), -1);
+
+    cbuf_write(&mycbuf, e, 8);
+    cbuf_read(&mycbuf, out, 3);
+    int ret = cbuf_compact(&mycbuf);
+
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(cbuf_get_pos(&mycbuf), 0);
+    ASSERT_EQ(cbuf_len(&mycbuf), 5);
+    ASSERT_EQ(cbuf_avail(&mycbuf), ecount - 5);
+    ASSERT_EQ(cbuf_read(&mycbuf, out, 8), 5);
+    ASSERT_THAT(std::vector<int>(out, out + 5), ::testing::ElementsAre(4, 5, 6, 7, 8));
+}
+
+#ifdef CBUF_STATS
+TEST_F(cbufTest, Stats)
+{
+    int e[ecount + 1] = {};
+    int out[ecount + 1];
+
+    cbuf_put(&mycbuf, e);
+    cbuf_write(&mycbuf, e, ecount);
+    cbuf_put(&mycbuf, e);
+    cbuf_read(&mycbuf, out, 2);
+    cbuf_compact(&mycbuf);
+    cbuf_read(&mycbuf, out, ecount);
+    cbuf_get(&mycbuf, out);
+
+    ASSERT_EQ(cbuf_stats(&mycbuf)->puts, ecount);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->gets, ecount);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->full, 2);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->empty, 2);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->compacted, (ecount - 2) * esize);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->peak, ecount);
+
+    cbuf_stats_reset(&mycbuf);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->puts, 0);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->peak, 0);
+}
+
+TEST_F(cbufTest, StatsFd)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+
+    ASSERT_EQ(cbuf_drain_to_fd(&mycbuf, fds[0]), 0);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->empty, 1);
+
+    int e[ecount] = {};
+    ASSERT_EQ(write(fds[1], e, sizeof(e)), sizeof(e));
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), ecount);
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), 0);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->puts, ecount);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->full, 1);
+
+    ASSERT_EQ(cbuf_drain_to_fd(&mycbuf, fds[0]), ecount);
+    ASSERT_EQ(cbuf_stats(&mycbuf)->gets, ecount);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(cbufStatsTest, Resize)
+{
+    struct cbuf mycbuf;
+    cbuf_alloc(&mycbuf, 8, sizeof(int));
+
+    int e[8] = {};
+    cbuf_write(&mycbuf, e, 6);
+    cbuf_resize(&mycbuf, 16);
+
+    ASSERT_EQ(cbuf_stats(&mycbuf)->resized, 6 * sizeof(int));
+    ASSERT_EQ(cbuf_stats(&mycbuf)->compacted, 0);
+    cbuf_free(&mycbuf);
+}
+#endif
+
+TEST_F(cbufTest, FillFromPipe)
+{
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+
+    int e[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    ASSERT_EQ(write(fds[1], e, sizeof(e)), sizeof(e));
+
+    ssize_t ret = cbuf_fill_from_fd(&mycbuf, fds[0]);
+
+    ASSERT_EQ(ret, 8);
+    ASSERT_EQ(cbuf_len(&mycbuf), 8);
+    ASSERT_EQ(cbuf_avail(&mycbuf), ecount - 8);
+
+    int out[8];
+    ASSERT_EQ(cbuf_read(&mycbuf, out, 8), 8);
+    ASSERT_THAT(out, ::testing::ElementsAre(1, 2, 3, 4, 5, 6, 7, 8));
+
+    close(fds[1]);
+    ret = cbuf_fill_from_fd(&mycbuf, fds[0]);
+
+    ASSERT_EQ(ret, 0);
+    ASSERT_TRUE(cbuf_is_empty(&mycbuf));
+    close(fds[0]);
+}
+
+TEST_F(cbufTest, FillFromPipeFull)
+{
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+
+    int e[ecount + 4];
+    for (size_t i = 0; i < ecount + 4; i++)
+    {
+        e[i] = i;
+    }
+    ASSERT_EQ(write(fds[1], e, sizeof(e)), sizeof(e));
+
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), ecount);
+    ASSERT_EQ(cbuf_avail(&mycbuf), 0);
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), 0);
+
+    int rest[4];
+    ASSERT_EQ(read(fds[0], rest, sizeof(rest)), sizeof(rest));
+    ASSERT_THAT(rest, ::testing::ElementsAre(ecount, ecount + 1, ecount + 2, ecount + 3));
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(cbufTest, FillPartialElement)
+{
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+
+    int e[2] = {10, 20};
+    ASSERT_EQ(write(fds[1], e, 6), 6);
+    close(fds[1]);
+
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), 1);
+    ASSERT_EQ(cbuf_len(&mycbuf), 1);
+
+    int out = 0;
+    ASSERT_EQ(cbuf_get(&mycbuf, &out), 1);
+    ASSERT_EQ(out, 10);
+    close(fds[0]);
+}
+
+TEST_F(cbufTest, FillNonBlockingPartial)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+
+    int e[2] = {10, 20};
+    ASSERT_EQ(write(fds[1], e, 6), 6);
+
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), 1);
+    ASSERT_EQ(cbuf_len(&mycbuf), 1);
+
+    errno = 0;
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), -1);
+    ASSERT_EQ(errno, EAGAIN);
+
+    ASSERT_EQ(write(fds[1], (char *)e + 6, 1), 1);
+    errno = 0;
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), -1);
+    ASSERT_EQ(errno, EAGAIN);
+    ASSERT_EQ(cbuf_len(&mycbuf), 1);
+
+    ASSERT_EQ(write(fds[1], (char *)e + 7, 1), 1);
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), 1);
+
+    int out[2];
+    ASSERT_EQ(cbuf_read(&mycbuf, out, 2), 2);
+    ASSERT_THAT(out, ::testing::ElementsAre(10, 20));
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(cbufTest, PutBlockedByPartialFill)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+
+    int e[2] = {10, 20};
+    ASSERT_EQ(write(fds[1], e, 6), 6);
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), 1);
+
+    int other[2] = {30, 40};
+    ASSERT_EQ(cbuf_put(&mycbuf, other), 0);
+    ASSERT_EQ(cbuf_write(&mycbuf, other, 2), 0);
+    ASSERT_EQ(cbuf_len(&mycbuf), 1);
+
+    ASSERT_EQ(write(fds[1], (char *)e + 6, 2), 2);
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[0]), 1);
+    ASSERT_EQ(cbuf_put(&mycbuf, other), 1);
+
+    int out[3];
+    ASSERT_EQ(cbuf_read(&mycbuf, out, 3), 3);
+    ASSERT_THAT(out, ::testing::ElementsAre(10, 20, 30));
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(cbufFdTest, GetBlockedByPartialDrain)
+{
+    const unsigned int count = 5000;
+    const size_t esize = 3;
+    int fds[2];
+    ASSERT_EQ(pipe2(fds, O_NONBLOCK), 0);
+    ASSERT_EQ(fcntl(fds[1], F_SETPIPE_SZ, 4096), 4096);
+
+    struct cbuf mycbuf;
+    cbuf_alloc(&mycbuf, count, esize);
+    std::vector<unsigned char> in(count * esize);
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        in[i] = i % 251;
+    }
+    cbuf_write(&mycbuf, in.data(), count);
+
+    /* 4096 bytes leave the element at get position partly written */
+    ASSERT_EQ(cbuf_drain_to_fd(&mycbuf, fds[1]), 4096 / esize);
+    unsigned char out[esize * 2];
+    ASSERT_EQ(cbuf_get(&mycbuf, out), 0);
+    ASSERT_EQ(cbuf_read(&mycbuf, out, 2), 0);
+    ASSERT_EQ(cbuf_len(&mycbuf), count - 4096 / esize);
+
+    /* 3 * 4096 bytes end on an element boundary, get works again after them */
+    unsigned char chunk[4096];
+    for (int i = 0; i < 2; i++)
+    {
+        ASSERT_EQ(read(fds[0], chunk, sizeof(chunk)), sizeof(chunk));
+        ASSERT_GT(cbuf_drain_to_fd(&mycbuf, fds[1]), 0);
+    }
+    ASSERT_EQ(cbuf_get_pos(&mycbuf), 3 * 4096 / esize);
+    ASSERT_EQ(cbuf_get(&mycbuf, out), 1);
+    ASSERT_EQ(memcmp(out, in.data() + 3 * 4096, esize), 0);
+
+    cbuf_free(&mycbuf);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(cbufFdTest, DrainNonBlockingPartial)
+{
+    const unsigned int count = 3000;
+    const size_t esize = 3;
+    int fds[2];
+    ASSERT_EQ(pipe2(fds, O_NONBLOCK), 0);
+    ASSERT_EQ(fcntl(fds[1], F_SETPIPE_SZ, 4096), 4096);
+
+    struct cbuf mycbuf;
+    cbuf_alloc(&mycbuf, count, esize);
+    std::vector<unsigned char> in(count * esize);
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        in[i] = i % 251;
+    }
+    ASSERT_EQ(cbuf_write(&mycbuf, in.data(), count), count);
+
+    /* the pipe takes 4096 bytes, which ends inside an element */
+    ASSERT_EQ(cbuf_drain_to_fd(&mycbuf, fds[1]), 4096 / esize);
+    errno = 0;
+    ASSERT_EQ(cbuf_drain_to_fd(&mycbuf, fds[1]), -1);
+    ASSERT_EQ(errno, EAGAIN);
+
+    std::vector<unsigned char> out;
+    unsigned char chunk[4096];
+    while (!cbuf_is_empty(&mycbuf))
+    {
+        ssize_t n = read(fds[0], chunk, sizeof(chunk));
+        ASSERT_GT(n, 0);
+        out.insert(out.end(), chunk, chunk + n);
+        cbuf_drain_to_fd(&mycbuf, fds[1]);
+    }
+    ssize_t n;
+    while ((n = read(fds[0], chunk, sizeof(chunk))) > 0)
+    {
+        out.insert(out.end(), chunk, chunk + n);
+    }
+
+    ASSERT_EQ(out, in);
+    cbuf_free(&mycbuf);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(cbufTest, DrainToSocketpair)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    int e[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    cbuf_write(&mycbuf, e, 8);
+    int out[3];
+    cbuf_read(&mycbuf, out, 3);
+
+    ssize_t ret = cbuf_drain_to_fd(&mycbuf, fds[0]);
+
+    ASSERT_EQ(ret, 5);
+    ASSERT_TRUE(cbuf_is_empty(&mycbuf));
+    ASSERT_EQ(cbuf_drain_to_fd(&mycbuf, fds[0]), 0);
+
+    int got[5];
+    ASSERT_EQ(read(fds[1], got, sizeof(got)), sizeof(got));
+    ASSERT_THAT(got, ::testing::ElementsAre(4, 5, 6, 7, 8));
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(cbufTest, SocketpairRoundTrip)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    int e[8] = {8, 7, 6, 5, 4, 3, 2, 1};
+    cbuf_write(&mycbuf, e, 8);
+    ASSERT_EQ(cbuf_drain_to_fd(&mycbuf, fds[0]), 8);
+
+    cbuf_reset(&mycbuf);
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, fds[1]), 8);
+
+    int out[8];
+    ASSERT_EQ(cbuf_read(&mycbuf, out, 8), 8);
+    ASSERT_THAT(out, ::testing::ElementsAre(8, 7, 6, 5, 4, 3, 2, 1));
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(cbufTest, DrainBadFd)
+{
+    int e = 1;
+    cbuf_put(&mycbuf, &e);
+
+    ASSERT_EQ(cbuf_drain_to_fd(&mycbuf, -1), -1);
+    ASSERT_EQ(cbuf_len(&mycbuf), 1);
+    ASSERT_EQ(cbuf_fill_from_fd(&mycbuf, -1), -1);
+    ASSERT_EQ(cbuf_len(&mycbuf), 1);
+}
+
+TEST(cbufResizeTest, AllocPool)
+{
+    char buffer[1024];
+    struct mempool pool;
+    struct cbuf mycbuf;
+    mempool_init(&pool, buffer, sizeof(buffer));
+
+    ASSERT_EQ(cbuf_alloc_pool(&mycbuf, &pool, 16, sizeof(int)), 0);
+    ASSERT_EQ(mempool_has(&pool, mycbuf.buf), 1);
+    ASSERT_EQ(cbuf_size(&mycbuf), 16);
+    ASSERT_EQ(mempool_avail(&pool), 1024 - 4 - 4 - 16 * sizeof(int));
+
+    ASSERT_EQ(cbuf_alloc_pool(&mycbuf, &pool, 1024, sizeof(int)), -1);
+    ASSERT_EQ(mempool_has(&pool, mycbuf.buf), 1);
+
+    cbuf_free(&mycbuf);
+    ASSERT_EQ(mempool_avail(&pool), 1024 - 4);
+}
+
+TEST(cbufResizeTest, Resize)
+{
+    char buffer[1024];
+    struct mempool pool;
+    struct cbuf mycbuf;
+    mempool_init(&pool, buffer, sizeof(buffer));
+    cbuf_alloc_pool(&mycbuf, &pool, 8, sizeof(int));
+
+    int e[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    cbuf_write(&mycbuf, e, 8);
+    int out[8];
+    cbuf_read(&mycbuf, out, 3);
+
+    ASSERT_EQ(cbuf_resize(&mycbuf, 4), -1);
+    ASSERT_EQ(cbuf_resize(&mycbuf, 32), 0);
+    ASSERT_EQ(mempool_has(&pool, mycbuf.buf), 1);
+    ASSERT_EQ(cbuf_size(&mycbuf), 32);
+    ASSERT_EQ(cbuf_get_pos(&mycbuf), 0);
+    ASSERT_EQ(cbuf_len(&mycbuf), 5);
+    ASSERT_EQ(cbuf_avail(&mycbuf), 27);
+
+    ASSERT_EQ(cbuf_resize(&mycbuf, 5), 0);
+    ASSERT_EQ(cbuf_avail(&mycbuf), 0);
+    ASSERT_EQ(cbuf_read(&mycbuf, out, 8), 5);
+    ASSERT_THAT(std::vector<int>(out, out + 5), ::testing::ElementsAre(4, 5, 6, 7, 8));
+
+    cbuf_free(&mycbuf);
+    ASSERT_EQ(mempool_avail(&pool), 1024 - 4);
+}
+
+TEST(cbufResizeTest, Overflow)
+{
+    struct cbuf mycbuf;
+
+    ASSERT_EQ(cbuf_alloc(&mycbuf, 0x40000001u, 4), -1);
+    ASSERT_EQ(cbuf_alloc(&mycbuf, 8, 0), -1);
+
+    cbuf_alloc(&mycbuf, 8, 256);
+    ASSERT_EQ(cbuf_resize(&mycbuf, 0x01000001u), -1);
+    ASSERT_EQ(cbuf_size(&mycbuf), 8);
+    cbuf_free(&mycbuf);
+}
+
+TEST(cbufResizeTest, AutoResize)
+{
+    struct cbuf mycbuf;
+    cbuf_alloc(&mycbuf, 8, sizeof(int));
+
+    int e[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    cbuf_write(&mycbuf, e, 5);
+    ASSERT_EQ(cbuf_autoresize(&mycbuf), 0);
+    ASSERT_EQ(cbuf_size(&mycbuf), 8);
+
+    cbuf_write(&mycbuf, e + 5, 1);
+    ASSERT_EQ(cbuf_autoresize(&mycbuf), 1);
+    ASSERT_EQ(cbuf_size(&mycbuf), 16);
+    ASSERT_EQ(cbuf_len(&mycbuf), 6);
+
+    int out[8];
+    cbuf_read(&mycbuf, out, 6);
+    ASSERT_THAT(std::vector<int>(out, out + 6), ::testing::ElementsAre(1, 2, 3, 4, 5, 6));
+
+    for (int i = 1; i < CBUF_SHRINK_DELAY; i++)
+    {
+        ASSERT_EQ(cbuf_autoresize(&mycbuf), 0);
+    }
+    ASSERT_EQ(cbuf_autoresize(&mycbuf), 1);
+    ASSERT_EQ(cbuf_size(&mycbuf), 8);
+
+    for (int i = 0; i < CBUF_SHRINK_DELAY * 2; i++)
+    {
+        ASSERT_EQ(cbuf_autoresize(&mycbuf), 0);
+    }
+    ASSERT_EQ(cbuf_size(&mycbuf), 8);
+
+    cbuf_free(&mycbuf);
+}
+
+TEST(cbufResizeTest, AutoResizeMoveToFront)
+{
+    struct cbuf mycbuf;
+    cbuf_alloc(&mycbuf, 8, sizeof(int));
+
+    int e[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    cbuf_write(&mycbuf, e, 8);
+    int out[8];
+    cbuf_read(&mycbuf, out, 7);
+
+    ASSERT_EQ(cbuf_autoresize(&mycbuf), 0);
+    ASSERT_EQ(cbuf_size(&mycbuf), 8);
+    ASSERT_EQ(cbuf_get_pos(&mycbuf), 0);
+    ASSERT_EQ(cbuf_avail(&mycbuf), 7);
+    ASSERT_EQ(cbuf_get(&mycbuf, out), 1);
+    ASSERT_EQ(out[0], 8);
+
+    cbuf_free(&mycbuf);
+}
+
+TEST_F(cbufTest, NotResizable)
+{
+    ASSERT_EQ(cbuf_resize(&mycbuf, ecount * 2), -1);
+    ASSERT_EQ(cbuf_autoresize(&mycbuf), -1);
+    ASSERT_EQ(cbuf_raw(&mycbuf), buffer);
+}